@@ -1,3 +1,6 @@
+// Versao anterior do trabalho, mantida congelada como referencia: tem sua propria
+// copia do parser, da consolidacao e do filtro e nao usa consolidacao.h.
+// O programa mantido e trab.cpp, ligado a libconsolidacao.a.
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -0,0 +1,1514 @@
+#include "consolidacao.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+// io_uring so existe no Linux; nos demais sistemas (ou sem os headers do
+// kernel) a ingestao em pipeline usa apenas as threads com std::ifstream.
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define CONSOLIDACAO_IO_URING 1
+#endif
+#endif
+
+namespace consolidacao
+{
+
+namespace
+{
+
+void aparar(const char *&inicio, const char *&fim)
+{
+    while (inicio < fim && (*inicio == ' ' || *inicio == '\t'))
+        inicio++;
+    while (fim > inicio && (fim[-1] == ' ' || fim[-1] == '\t'))
+        fim--;
+    // from_chars nao aceita '+'; so o descarta antes de um digito ou '.', para nao aceitar "+-5"
+    if (fim - inicio > 1 && *inicio == '+' && (std::isdigit(static_cast<unsigned char>(inicio[1])) || inicio[1] == '.'))
+        inicio++;
+}
+
+ErroLinha lerInteiro(const char *inicio, const char *fim, int &valor)
+{
+    aparar(inicio, fim);
+    auto [p, ec] = std::from_chars(inicio, fim, valor);
+    if (ec == std::errc::result_out_of_range)
+        return ErroLinha::ForaDoIntervalo;
+    if (ec != std::errc() || p != fim)
+        return ErroLinha::NaoNumerico;
+    return ErroLinha::Nenhum;
+}
+
+ErroLinha lerReal(const char *inicio, const char *fim, double &valor)
+{
+    aparar(inicio, fim);
+    auto [p, ec] = std::from_chars(inicio, fim, valor);
+    if (ec == std::errc::result_out_of_range)
+        return ErroLinha::ForaDoIntervalo;
+    if (ec != std::errc() || p != fim)
+        return ErroLinha::NaoNumerico;
+    if (!std::isfinite(valor))
+        return ErroLinha::ForaDoIntervalo;
+    return ErroLinha::Nenhum;
+}
+
+} // namespace
+
+const char *descreverErroLinha(ErroLinha erro)
+{
+    switch (erro)
+    {
+    case ErroLinha::Nenhum:
+        return "ok";
+    case ErroLinha::LinhaVazia:
+        return "linha vazia";
+    case ErroLinha::CamposFaltando:
+        return "campos faltando";
+    case ErroLinha::CamposSobrando:
+        return "campos sobrando";
+    case ErroLinha::NaoNumerico:
+        return "campo nao numerico";
+    case ErroLinha::ForaDoIntervalo:
+        return "valor fora do intervalo";
+    }
+    return "desconhecido";
+}
+
+const char *nomeCampoTransacao(int campo)
+{
+    static const char *nomes[NUM_CAMPOS_TRANSACAO] = {"dia", "mes", "ano", "agencia_origem", "conta_origem", "valor", "agencia_destino", "conta_destino"};
+    return campo >= 0 && campo < NUM_CAMPOS_TRANSACAO ? nomes[campo] : "-";
+}
+
+ErroLinha validarTransacao(const char *inicio, const char *fim, Transacao &t, int &campoErro)
+{
+    if (fim > inicio && fim[-1] == '\r')
+        fim--;
+    campoErro = -1;
+    if (inicio == fim)
+        return ErroLinha::LinhaVazia;
+
+    const char *campos[NUM_CAMPOS_TRANSACAO + 1];
+    int n = 0;
+    campos[n++] = inicio;
+    for (const char *p = inicio; p < fim; p++)
+    {
+        if (*p == ',')
+        {
+            if (n == NUM_CAMPOS_TRANSACAO)
+                return ErroLinha::CamposSobrando;
+            campos[n++] = p + 1;
+        }
+    }
+    if (n < NUM_CAMPOS_TRANSACAO)
+    {
+        campoErro = n;
+        return ErroLinha::CamposFaltando;
+    }
+    campos[n] = fim + 1;
+
+    int *inteiros[NUM_CAMPOS_TRANSACAO] = {&t.dia, &t.mes, &t.ano, &t.agencia_origem, &t.conta_origem, nullptr, &t.agencia_destino, &t.conta_destino};
+    for (int i = 0; i < NUM_CAMPOS_TRANSACAO; i++)
+    {
+        const char *a = campos[i], *b = campos[i + 1] - 1;
+        ErroLinha erro;
+        if (i == 5)
+            erro = lerReal(a, b, t.valor);
+        else if (i >= 6 && a == b)
+        {
+            *inteiros[i] = 0;
+            erro = ErroLinha::Nenhum;
+        }
+        else
+            erro = lerInteiro(a, b, *inteiros[i]);
+        if (erro != ErroLinha::Nenhum)
+        {
+            campoErro = i;
+            return erro;
+        }
+    }
+    if (t.dia < 1 || t.dia > 31)
+    {
+        campoErro = 0;
+        return ErroLinha::ForaDoIntervalo;
+    }
+    if (t.mes < 1 || t.mes > 12)
+    {
+        campoErro = 1;
+        return ErroLinha::ForaDoIntervalo;
+    }
+    // A chave de consolidacao e agencia * 1000000 + conta em int
+    if (t.agencia_origem < 0 || t.agencia_origem > AGENCIA_MAXIMA)
+    {
+        campoErro = 3;
+        return ErroLinha::ForaDoIntervalo;
+    }
+    if (t.conta_origem < 0 || t.conta_origem > CONTA_MAXIMA)
+    {
+        campoErro = 4;
+        return ErroLinha::ForaDoIntervalo;
+    }
+    return ErroLinha::Nenhum;
+}
+
+void reiniciarQuarentena(Quarentena &q)
+{
+    if (q.arquivo.is_open())
+        q.arquivo.close();
+    if (!q.caminho.empty())
+        std::remove(q.caminho.c_str());
+    q.aceitas = q.rejeitadas = 0;
+    std::fill(std::begin(q.porErro), std::end(q.porErro), 0);
+}
+
+void registrarRejeitada(Quarentena &q, const LinhaRejeitada &r)
+{
+    q.rejeitadas++;
+    q.porErro[static_cast<int>(r.erro)]++;
+    if (q.caminho.empty())
+        return;
+    if (!q.arquivo.is_open())
+    {
+        q.arquivo.open(q.caminho, std::ios::trunc);
+        q.arquivo << "offset;motivo;campo;linha" << '\n';
+    }
+    size_t tamanho = r.conteudo.size() - (!r.conteudo.empty() && r.conteudo.back() == '\r');
+    q.arquivo << r.offset << ';' << descreverErroLinha(r.erro) << ';' << nomeCampoTransacao(r.campo) << ';';
+    q.arquivo.write(r.conteudo.data(), tamanho) << '\n';
+}
+
+std::string resumirQuarentena(const Quarentena &q)
+{
+    std::string resumo = std::to_string(q.aceitas) + " linhas aceitas, " + std::to_string(q.rejeitadas) + " rejeitadas";
+    if (q.rejeitadas == 0)
+        return resumo;
+    resumo += " (";
+    bool primeiro = true;
+    for (int i = 1; i < NUM_ERROS_LINHA; i++)
+    {
+        if (q.porErro[i] == 0)
+            continue;
+        resumo += (primeiro ? "" : ", ") + std::string(descreverErroLinha(static_cast<ErroLinha>(i))) + ": " + std::to_string(q.porErro[i]);
+        primeiro = false;
+    }
+    return resumo + ")" + (q.caminho.empty() ? "" : " em " + q.caminho);
+}
+
+bool carregarTransacoes(const std::string &arquivoCSV, std::pmr::vector<Transacao> &transacoes, Quarentena &quarentena)
+{
+    reiniciarQuarentena(quarentena);
+    std::ifstream file(arquivoCSV);
+    if (!file)
+        return false;
+    std::string linha;
+    long long offset = 0;
+    while (std::getline(file, linha))
+    {
+        Transacao t;
+        int campo;
+        const char *inicio = linha.data();
+        ErroLinha erro = validarTransacao(inicio, inicio + linha.size(), t, campo);
+        if (erro == ErroLinha::Nenhum)
+        {
+            transacoes.push_back(t);
+            quarentena.aceitas++;
+        }
+        else
+        {
+            registrarRejeitada(quarentena, {offset, erro, campo, linha});
+        }
+        offset += linha.size() + 1;
+    }
+    // getline para no fim do arquivo; badbit indica erro de leitura no meio dele
+    return !file.bad();
+}
+
+void consolidarMovimentacao(const Transacao *transacoes, size_t quantidade, int mes, int ano, MapaConsolidacao &consolidacao)
+{
+    for (const Transacao *t = transacoes; t != transacoes + quantidade; ++t)
+    {
+        if (t->mes == mes && t->ano == ano)
+        {
+            int chave = t->agencia_origem * 1000000 + t->conta_origem; // Cria uma chave única combinando agência e conta
+            MovimentacaoConsolidada &mov = consolidacao[chave];
+            mov.agencia = t->agencia_origem;
+            mov.conta = t->conta_origem;
+            if (t->agencia_destino == 0 && t->conta_destino == 0)
+            {
+                mov.subtotal_especie += t->valor;
+            }
+            else
+            {
+                mov.subtotal_eletronica += t->valor;
+            }
+            mov.total_transacoes++;
+        }
+    }
+}
+
+void finalizarConsolidacao(const MapaConsolidacao &consolidacao, ResultadoConsolidacao &resultado)
+{
+    resultado.movimentacoes.clear();
+    resultado.movimentacoes.reserve(consolidacao.size());
+    for (const auto &entry : consolidacao)
+    {
+        resultado.movimentacoes.push_back(entry.second);
+    }
+}
+
+namespace
+{
+
+// Ingestao em pipeline: uma thread leitora mantem varias leituras grandes em
+// voo (io_uring quando o kernel permite, senao threads com std::ifstream), entrega os
+// blocos por uma fila limitada aos parsers, que alimentam a consolidacao.
+// Filas limitadas e um pool fixo de buffers aplicam backpressure em cada etapa.
+const size_t TAMANHO_BLOCO_LEITURA = 1 << 20;
+const size_t FOLGA_LINHA = 64 << 10; // Espaco antes do bloco para o pedaco de linha do bloco anterior
+const int PROFUNDIDADE_LEITURA = 8;  // Leituras em voo ao mesmo tempo
+const int THREADS_LEITURA_FALLBACK = 2;
+const unsigned FILA_LOTES = 8;
+
+template <typename T>
+class FilaLimitada
+{
+public:
+    explicit FilaLimitada(size_t capacidade) : capacidade(capacidade) {}
+
+    // Bloqueia enquanto a fila estiver cheia
+    void inserir(T item)
+    {
+        std::unique_lock<std::mutex> trava(mutex);
+        naoCheia.wait(trava, [this] { return itens.size() < capacidade; });
+        itens.push_back(std::move(item));
+        naoVazia.notify_one();
+    }
+
+    // Bloqueia enquanto a fila estiver vazia; retorna false quando fechada e vazia
+    bool retirar(T &item)
+    {
+        std::unique_lock<std::mutex> trava(mutex);
+        naoVazia.wait(trava, [this] { return !itens.empty() || fechada; });
+        if (itens.empty())
+            return false;
+        item = std::move(itens.front());
+        itens.pop_front();
+        naoCheia.notify_one();
+        return true;
+    }
+
+    bool tentarRetirar(T &item)
+    {
+        std::lock_guard<std::mutex> trava(mutex);
+        if (itens.empty())
+            return false;
+        item = std::move(itens.front());
+        itens.pop_front();
+        naoCheia.notify_one();
+        return true;
+    }
+
+    void fechar()
+    {
+        std::lock_guard<std::mutex> trava(mutex);
+        fechada = true;
+        naoVazia.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable naoCheia, naoVazia;
+    std::deque<T> itens;
+    size_t capacidade;
+    bool fechada = false;
+};
+
+struct BufferLeitura
+{
+    std::vector<char> memoria;
+    size_t inicio = 0, fim = 0; // Linhas completas prontas para o parser
+    long long offsetArquivo = 0; // Posicao de memoria[inicio] no arquivo
+    size_t ordem = 0;            // Posicao na sequencia entregue aos parsers
+    bool doPool = true;
+    // Pedido de leitura em voo
+    size_t sequencia = 0;
+    long long offset = 0;
+    size_t tamanho = 0, lido = 0;
+    long resultado = 0; // Bytes lidos, ou negativo em caso de erro
+#ifdef CONSOLIDACAO_IO_URING
+    iovec iov;
+#endif
+};
+
+struct LeitorAssincrono
+{
+    std::string caminho;
+    long long tamanhoArquivo = 0;
+    bool usaIoUring = false;
+#ifdef CONSOLIDACAO_IO_URING
+    int fd = -1;
+    int anel = -1;
+    void *mapaSq = MAP_FAILED, *mapaCq = MAP_FAILED, *mapaSqes = MAP_FAILED;
+    size_t tamanhoSq = 0, tamanhoCq = 0, tamanhoSqes = 0;
+    unsigned *sqCauda = nullptr, *sqMascara = nullptr, *sqIndices = nullptr;
+    unsigned *cqCabeca = nullptr, *cqCauda = nullptr, *cqMascara = nullptr;
+    io_uring_sqe *sqes = nullptr;
+    io_uring_cqe *cqes = nullptr;
+#endif
+    FilaLimitada<BufferLeitura *> pedidos{PROFUNDIDADE_LEITURA};
+    FilaLimitada<BufferLeitura *> concluidos{PROFUNDIDADE_LEITURA};
+    std::vector<std::thread> threadsLeitura;
+};
+
+#ifdef CONSOLIDACAO_IO_URING
+bool iniciarIoUring(LeitorAssincrono &l)
+{
+    l.fd = open(l.caminho.c_str(), O_RDONLY);
+    if (l.fd < 0)
+        return false;
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    int anel = static_cast<int>(syscall(__NR_io_uring_setup, PROFUNDIDADE_LEITURA, &params));
+    if (anel < 0)
+        return false;
+    l.anel = anel;
+    l.tamanhoSq = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    l.tamanhoCq = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool mapaUnico = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (mapaUnico)
+        l.tamanhoSq = l.tamanhoCq = std::max(l.tamanhoSq, l.tamanhoCq);
+    l.mapaSq = mmap(nullptr, l.tamanhoSq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, anel, IORING_OFF_SQ_RING);
+    if (l.mapaSq == MAP_FAILED)
+        return false;
+    l.mapaCq = mapaUnico ? l.mapaSq : mmap(nullptr, l.tamanhoCq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, anel, IORING_OFF_CQ_RING);
+    if (l.mapaCq == MAP_FAILED)
+        return false;
+    l.tamanhoSqes = params.sq_entries * sizeof(io_uring_sqe);
+    l.mapaSqes = mmap(nullptr, l.tamanhoSqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, anel, IORING_OFF_SQES);
+    if (l.mapaSqes == MAP_FAILED)
+        return false;
+
+    char *sq = static_cast<char *>(l.mapaSq);
+    char *cq = static_cast<char *>(l.mapaCq);
+    l.sqCauda = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    l.sqMascara = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    l.sqIndices = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    l.cqCabeca = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    l.cqCauda = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    l.cqMascara = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    l.sqes = static_cast<io_uring_sqe *>(l.mapaSqes);
+    l.cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+}
+
+void encerrarIoUring(LeitorAssincrono &l)
+{
+    if (l.mapaSqes != MAP_FAILED)
+        munmap(l.mapaSqes, l.tamanhoSqes);
+    if (l.mapaCq != MAP_FAILED && l.mapaCq != l.mapaSq)
+        munmap(l.mapaCq, l.tamanhoCq);
+    if (l.mapaSq != MAP_FAILED)
+        munmap(l.mapaSq, l.tamanhoSq);
+    if (l.anel >= 0)
+        close(l.anel);
+    if (l.fd >= 0)
+        close(l.fd);
+    l.mapaSq = l.mapaCq = l.mapaSqes = MAP_FAILED;
+    l.anel = -1;
+    l.fd = -1;
+}
+
+int entrarIoUring(LeitorAssincrono &l, unsigned submeter, unsigned minimo, unsigned flags)
+{
+    int r;
+    do
+    {
+        r = static_cast<int>(syscall(__NR_io_uring_enter, l.anel, submeter, minimo, flags, nullptr, 0));
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+bool submeterIoUring(LeitorAssincrono &l, BufferLeitura *b)
+{
+    unsigned cauda = *l.sqCauda;
+    unsigned indice = cauda & *l.sqMascara;
+    io_uring_sqe *sqe = &l.sqes[indice];
+    std::memset(sqe, 0, sizeof(*sqe));
+    b->iov.iov_base = b->memoria.data() + FOLGA_LINHA + b->lido;
+    b->iov.iov_len = b->tamanho - b->lido;
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = l.fd;
+    sqe->addr = reinterpret_cast<unsigned long>(&b->iov);
+    sqe->len = 1;
+    sqe->off = b->offset + b->lido;
+    sqe->user_data = reinterpret_cast<unsigned long>(b);
+    l.sqIndices[indice] = indice;
+    __atomic_store_n(l.sqCauda, cauda + 1, __ATOMIC_RELEASE);
+    return entrarIoUring(l, 1, 0, 0) == 1;
+}
+
+BufferLeitura *aguardarIoUring(LeitorAssincrono &l)
+{
+    unsigned cabeca = *l.cqCabeca;
+    while (cabeca == __atomic_load_n(l.cqCauda, __ATOMIC_ACQUIRE))
+    {
+        if (entrarIoUring(l, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+            return nullptr;
+    }
+    const io_uring_cqe &cqe = l.cqes[cabeca & *l.cqMascara];
+    BufferLeitura *b = reinterpret_cast<BufferLeitura *>(cqe.user_data);
+    b->resultado = cqe.res;
+    __atomic_store_n(l.cqCabeca, cabeca + 1, __ATOMIC_RELEASE);
+    return b;
+}
+#endif
+
+// Fallback portavel: cada thread tem seu proprio std::ifstream e atende pedidos com seekg/read
+void executarLeituras(LeitorAssincrono &l)
+{
+    std::ifstream arquivo(l.caminho, std::ios::binary);
+    BufferLeitura *b;
+    while (l.pedidos.retirar(b))
+    {
+        size_t falta = b->tamanho - b->lido;
+        arquivo.clear();
+        arquivo.seekg(b->offset + b->lido);
+        arquivo.read(b->memoria.data() + FOLGA_LINHA + b->lido, falta);
+        std::streamsize lidos = arquivo.gcount();
+        b->resultado = (lidos > 0 || arquivo) ? static_cast<long>(lidos) : -1;
+        l.concluidos.inserir(b);
+    }
+}
+
+bool iniciarLeitor(LeitorAssincrono &l, const std::string &caminho)
+{
+    std::ifstream arquivo(caminho, std::ios::binary | std::ios::ate);
+    if (!arquivo)
+        return false;
+    l.caminho = caminho;
+    l.tamanhoArquivo = static_cast<long long>(arquivo.tellg());
+#ifdef CONSOLIDACAO_IO_URING
+    l.usaIoUring = iniciarIoUring(l);
+    if (!l.usaIoUring)
+        encerrarIoUring(l);
+#endif
+    if (!l.usaIoUring)
+    {
+        for (int i = 0; i < THREADS_LEITURA_FALLBACK; i++)
+            l.threadsLeitura.emplace_back(executarLeituras, std::ref(l));
+    }
+    return true;
+}
+
+void encerrarLeitor(LeitorAssincrono &l)
+{
+    l.pedidos.fechar();
+    for (auto &t : l.threadsLeitura)
+        t.join();
+    l.threadsLeitura.clear();
+#ifdef CONSOLIDACAO_IO_URING
+    encerrarIoUring(l);
+#endif
+}
+
+bool submeterLeitura(LeitorAssincrono &l, BufferLeitura *b)
+{
+#ifdef CONSOLIDACAO_IO_URING
+    if (l.usaIoUring)
+        return submeterIoUring(l, b);
+#endif
+    l.pedidos.inserir(b);
+    return true;
+}
+
+BufferLeitura *aguardarLeitura(LeitorAssincrono &l)
+{
+#ifdef CONSOLIDACAO_IO_URING
+    if (l.usaIoUring)
+        return aguardarIoUring(l);
+#endif
+    BufferLeitura *b = nullptr;
+    l.concluidos.retirar(b);
+    return b;
+}
+
+void devolverBuffer(BufferLeitura *b, FilaLimitada<BufferLeitura *> &livres)
+{
+    if (b->doPool)
+        livres.inserir(b);
+    else
+        delete b;
+}
+
+// Junta o pedaco de linha do bloco anterior e separa o que sobra apos a ultima quebra
+void entregarBloco(BufferLeitura *b, std::string &resto, size_t &entregues, FilaLimitada<BufferLeitura *> &livres,
+                   FilaLimitada<BufferLeitura *> &paraParsear)
+{
+    char *dados = b->memoria.data() + FOLGA_LINHA;
+    size_t corte = b->lido;
+    while (corte > 0 && dados[corte - 1] != '\n')
+        corte--;
+    if (corte == 0)
+    {
+        resto.append(dados, b->lido);
+        devolverBuffer(b, livres);
+        return;
+    }
+    if (resto.size() <= FOLGA_LINHA)
+    {
+        std::memcpy(dados - resto.size(), resto.data(), resto.size());
+        b->inicio = FOLGA_LINHA - resto.size();
+        b->fim = FOLGA_LINHA + corte;
+        b->offsetArquivo = b->offset - static_cast<long long>(resto.size());
+        resto.assign(dados + corte, b->lido - corte);
+        b->ordem = entregues++;
+        paraParsear.inserir(b);
+        return;
+    }
+    // Linha maior que a folga: copia para um buffer avulso
+    BufferLeitura *avulso = new BufferLeitura;
+    avulso->doPool = false;
+    avulso->memoria.assign(resto.begin(), resto.end());
+    avulso->memoria.insert(avulso->memoria.end(), dados, dados + corte);
+    avulso->fim = avulso->memoria.size();
+    avulso->offsetArquivo = b->offset - static_cast<long long>(resto.size());
+    avulso->ordem = entregues++;
+    resto.assign(dados + corte, b->lido - corte);
+    devolverBuffer(b, livres);
+    paraParsear.inserir(avulso);
+}
+
+// Etapa leitora: mantem ate PROFUNDIDADE_LEITURA leituras em voo e entrega os blocos em ordem
+bool lerBlocos(LeitorAssincrono &l, long long tamanhoArquivo, size_t tamanhoBloco, FilaLimitada<BufferLeitura *> &livres,
+               FilaLimitada<BufferLeitura *> &paraParsear)
+{
+    size_t numBlocos = (tamanhoArquivo + tamanhoBloco - 1) / tamanhoBloco;
+    size_t proximoEnviar = 0, proximoEntregar = 0, entregues = 0;
+    int emVoo = 0;
+    bool ok = true;
+    std::map<size_t, BufferLeitura *> prontos; // Blocos concluidos fora de ordem
+    std::string resto;
+
+    while (emVoo > 0 || (ok && proximoEnviar < numBlocos))
+    {
+        while (ok && emVoo < PROFUNDIDADE_LEITURA && proximoEnviar < numBlocos)
+        {
+            BufferLeitura *b = nullptr;
+            if (emVoo > 0)
+            {
+                if (!livres.tentarRetirar(b))
+                    break;
+            }
+            else
+            {
+                livres.retirar(b);
+            }
+            b->sequencia = proximoEnviar;
+            b->offset = static_cast<long long>(proximoEnviar * tamanhoBloco);
+            b->tamanho = std::min<size_t>(tamanhoBloco, tamanhoArquivo - b->offset);
+            b->lido = 0;
+            if (!submeterLeitura(l, b))
+            {
+                ok = false;
+                devolverBuffer(b, livres);
+                break;
+            }
+            emVoo++;
+            proximoEnviar++;
+        }
+        if (emVoo == 0)
+            break;
+
+        BufferLeitura *b = aguardarLeitura(l);
+        if (!b)
+        {
+            ok = false;
+            break;
+        }
+        emVoo--;
+        if (b->resultado <= 0)
+        {
+            ok = false;
+            devolverBuffer(b, livres);
+            continue;
+        }
+        b->lido += b->resultado;
+        if (b->lido < b->tamanho && ok)
+        {
+            // Leitura curta: pede o restante do bloco
+            if (submeterLeitura(l, b))
+            {
+                emVoo++;
+                continue;
+            }
+            ok = false;
+        }
+        if (!ok)
+        {
+            devolverBuffer(b, livres);
+            continue;
+        }
+        prontos[b->sequencia] = b;
+        for (auto it = prontos.find(proximoEntregar); it != prontos.end(); it = prontos.find(proximoEntregar))
+        {
+            entregarBloco(it->second, resto, entregues, livres, paraParsear);
+            prontos.erase(it);
+            proximoEntregar++;
+        }
+    }
+
+    for (auto &entry : prontos)
+        devolverBuffer(entry.second, livres);
+    if (ok && !resto.empty())
+    {
+        BufferLeitura *ultimo = new BufferLeitura;
+        ultimo->doPool = false;
+        ultimo->memoria.assign(resto.begin(), resto.end());
+        ultimo->fim = ultimo->memoria.size();
+        ultimo->offsetArquivo = tamanhoArquivo - static_cast<long long>(resto.size());
+        ultimo->ordem = entregues++;
+        paraParsear.inserir(ultimo);
+    }
+    return ok;
+}
+
+struct LoteTransacoes
+{
+    size_t ordem = 0; // Mesma ordem do buffer de origem
+    std::vector<Transacao> transacoes; // Somente as do mes/ano pedido
+    std::vector<LinhaRejeitada> rejeitadas;
+    long long aceitas = 0;
+};
+
+// Etapa de parse: valida linhas completas e gera lotes de transacoes do mes/ano pedido
+void parsearBlocos(FilaLimitada<BufferLeitura *> &paraParsear, FilaLimitada<BufferLeitura *> &livres,
+                   FilaLimitada<LoteTransacoes> &lotes, int mes, int ano)
+{
+    BufferLeitura *b;
+    while (paraParsear.retirar(b))
+    {
+        LoteTransacoes lote;
+        lote.ordem = b->ordem;
+        const char *base = b->memoria.data() + b->inicio;
+        const char *p = base;
+        const char *fim = b->memoria.data() + b->fim;
+        while (p < fim)
+        {
+            const char *quebra = static_cast<const char *>(std::memchr(p, '\n', fim - p));
+            if (!quebra)
+                quebra = fim;
+            Transacao t;
+            int campo;
+            ErroLinha erro = validarTransacao(p, quebra, t, campo);
+            if (erro == ErroLinha::Nenhum)
+            {
+                lote.aceitas++;
+                if (t.mes == mes && t.ano == ano)
+                    lote.transacoes.push_back(t);
+            }
+            else
+            {
+                lote.rejeitadas.push_back({b->offsetArquivo + (p - base), erro, campo, std::string(p, quebra)});
+            }
+            p = quebra + 1;
+        }
+        devolverBuffer(b, livres);
+        lotes.inserir(std::move(lote));
+    }
+}
+
+} // namespace
+
+bool consolidarMovimentacaoPipeline(const std::string &arquivoCSV, int mes, int ano, MapaConsolidacao &consolidacao,
+                                    Quarentena &quarentena, bool &usouIoUring, const OpcoesPipeline &opcoes)
+{
+    LeitorAssincrono leitor;
+    if (!iniciarLeitor(leitor, arquivoCSV))
+        return false;
+    usouIoUring = leitor.usaIoUring;
+    reiniciarQuarentena(quarentena);
+
+    int numParsers = opcoes.numParsers > 0 ? opcoes.numParsers : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    size_t tamanhoBloco = opcoes.tamanhoBloco > 0 ? opcoes.tamanhoBloco : TAMANHO_BLOCO_LEITURA;
+    size_t numBuffers = PROFUNDIDADE_LEITURA + numParsers + 2;
+    std::vector<BufferLeitura> buffers(numBuffers);
+    FilaLimitada<BufferLeitura *> livres(numBuffers);
+    FilaLimitada<BufferLeitura *> paraParsear(numParsers + 1);
+    FilaLimitada<LoteTransacoes> lotes(FILA_LOTES);
+    for (auto &b : buffers)
+    {
+        b.memoria.resize(FOLGA_LINHA + tamanhoBloco);
+        livres.inserir(&b);
+    }
+
+    bool leituraOk = true;
+    std::thread leitora([&] {
+        leituraOk = lerBlocos(leitor, leitor.tamanhoArquivo, tamanhoBloco, livres, paraParsear);
+        paraParsear.fechar();
+    });
+    std::atomic<int> parsersAtivos(numParsers);
+    std::vector<std::thread> parsers;
+    for (int i = 0; i < numParsers; i++)
+    {
+        parsers.emplace_back([&] {
+            parsearBlocos(paraParsear, livres, lotes, mes, ano);
+            if (--parsersAtivos == 0)
+                lotes.fechar();
+        });
+    }
+
+    // Os lotes chegam na ordem em que os parsers terminam, mas sao somados na
+    // ordem do arquivo para que os subtotais e a quarentena saiam identicos aos do
+    // caminho sequencial
+    std::map<size_t, LoteTransacoes> prontos; // Lotes que chegaram antes da vez
+    size_t proximoSomar = 0;
+    LoteTransacoes lote;
+    while (lotes.retirar(lote))
+    {
+        prontos[lote.ordem] = std::move(lote);
+        for (auto it = prontos.find(proximoSomar); it != prontos.end(); it = prontos.find(proximoSomar))
+        {
+            LoteTransacoes &atual = it->second;
+            consolidarMovimentacao(atual.transacoes.data(), atual.transacoes.size(), mes, ano, consolidacao);
+            quarentena.aceitas += atual.aceitas;
+            for (const auto &r : atual.rejeitadas)
+                registrarRejeitada(quarentena, r);
+            prontos.erase(it);
+            proximoSomar++;
+        }
+    }
+
+    leitora.join();
+    for (auto &t : parsers)
+        t.join();
+    encerrarLeitor(leitor);
+    return leituraOk;
+}
+
+std::string nomeArquivoConsolidacao(int mes, int ano)
+{
+    return "consolidadas" + std::to_string(mes) + std::to_string(ano) + ".bin";
+}
+
+void salvarConsolidacaoBinaria(VisaoMovimentacoes movimentacoes, const std::string &caminho)
+{
+    std::ofstream binFile(caminho, std::ios::binary);
+    binFile.write(reinterpret_cast<const char *>(movimentacoes.begin()), movimentacoes.size() * sizeof(MovimentacaoConsolidada));
+}
+
+bool carregarConsolidacaoBinaria(ResultadoConsolidacao &resultado, const std::string &caminho)
+{
+    std::ifstream binFile(caminho, std::ios::binary | std::ios::ate);
+    if (!binFile)
+        return false;
+    std::streamoff tamanho = binFile.tellg();
+    // Tamanho que nao e multiplo do registro indica arquivo truncado ou de outro formato
+    if (tamanho < 0 || tamanho % sizeof(MovimentacaoConsolidada) != 0)
+        return false;
+    // O arquivo ja esta em ordem de agencia e conta: uma unica leitura preenche o vetor
+    size_t quantidade = static_cast<size_t>(tamanho) / sizeof(MovimentacaoConsolidada);
+    binFile.seekg(0);
+    resultado.movimentacoes.resize(quantidade);
+    binFile.read(reinterpret_cast<char *>(resultado.movimentacoes.data()), tamanho);
+    if (binFile.gcount() != tamanho)
+    {
+        resultado.movimentacoes.clear();
+        return false;
+    }
+    return true;
+}
+
+// ---- Filtros ----
+// A expressao e compilada uma unica vez para um programa pos-fixo plano;
+// formatos comuns (uma comparacao ou um par E/OU de limites) sao despachados
+// para kernels especializados por template.
+
+namespace
+{
+
+enum CampoFiltro
+{
+    CAMPO_ESPECIE,
+    CAMPO_ELETRONICA,
+    CAMPO_TOTAL,
+    CAMPO_TOTAL_TRANSACOES,
+    CAMPO_AGENCIA,
+    CAMPO_CONTA,
+    CAMPO_UM, // Constante 1.0, usada para representar numeros e divisores
+    NUM_CAMPOS_FILTRO
+};
+
+enum class OpFiltro
+{
+    Menor,
+    MenorIgual,
+    Maior,
+    MaiorIgual,
+    Igual,
+    Diferente
+};
+
+enum class TipoInstrucao
+{
+    Comparacao,
+    Pertence,
+    E,
+    Ou,
+    Nao
+};
+
+const int PROFUNDIDADE_MAXIMA_FILTRO = 64;
+
+// Operando na forma escala * valores[num] / valores[den]
+struct OperandoFiltro
+{
+    int num = CAMPO_UM;
+    int den = CAMPO_UM;
+    double escala = 0.0;
+};
+
+struct InstrucaoFiltro
+{
+    TipoInstrucao tipo;
+    OpFiltro op = OpFiltro::MaiorIgual;
+    bool (*comparador)(double, double) = nullptr;
+    OperandoFiltro esq, dir;
+    int lista = -1;
+};
+
+
+} // namespace
+
+struct ProgramaFiltro
+{
+    std::vector<InstrucaoFiltro> instrucoes;
+    std::vector<std::vector<double>> listas;
+};
+
+namespace
+{
+
+inline void carregarValoresFiltro(const MovimentacaoConsolidada &mov, double *valores)
+{
+    valores[CAMPO_ESPECIE] = mov.subtotal_especie;
+    valores[CAMPO_ELETRONICA] = mov.subtotal_eletronica;
+    valores[CAMPO_TOTAL] = mov.subtotal_especie + mov.subtotal_eletronica;
+    valores[CAMPO_TOTAL_TRANSACOES] = mov.total_transacoes;
+    valores[CAMPO_AGENCIA] = mov.agencia;
+    valores[CAMPO_CONTA] = mov.conta;
+    valores[CAMPO_UM] = 1.0;
+}
+
+bool aceitarTodas(const ProgramaFiltro &, const MovimentacaoConsolidada &)
+{
+    return true;
+}
+
+template <OpFiltro O>
+inline bool comparar(double a, double b)
+{
+    if constexpr (O == OpFiltro::Menor)
+        return a < b;
+    else if constexpr (O == OpFiltro::MenorIgual)
+        return a <= b;
+    else if constexpr (O == OpFiltro::Maior)
+        return a > b;
+    else if constexpr (O == OpFiltro::MaiorIgual)
+        return a >= b;
+    else if constexpr (O == OpFiltro::Igual)
+        return a == b;
+    else
+        return a != b;
+}
+
+inline double valorOperando(const OperandoFiltro &o, const double *valores)
+{
+    return o.escala * valores[o.num] / valores[o.den];
+}
+
+// Kernel para "campo op constante"
+template <OpFiltro O>
+bool kernelComparacao(const ProgramaFiltro &filtro, const MovimentacaoConsolidada &mov)
+{
+    double valores[NUM_CAMPOS_FILTRO];
+    carregarValoresFiltro(mov, valores);
+    const InstrucaoFiltro &c = filtro.instrucoes[0];
+    return comparar<O>(valores[c.esq.num], c.dir.escala);
+}
+
+// Kernel para "campo op constante E/OU campo op constante", sem curto-circuito
+template <bool Conjuncao, OpFiltro O1, OpFiltro O2>
+bool kernelPar(const ProgramaFiltro &filtro, const MovimentacaoConsolidada &mov)
+{
+    double valores[NUM_CAMPOS_FILTRO];
+    carregarValoresFiltro(mov, valores);
+    const InstrucaoFiltro &a = filtro.instrucoes[0];
+    const InstrucaoFiltro &b = filtro.instrucoes[1];
+    bool ra = comparar<O1>(valores[a.esq.num], a.dir.escala);
+    bool rb = comparar<O2>(valores[b.esq.num], b.dir.escala);
+    return Conjuncao ? (ra & rb) : (ra | rb);
+}
+
+// Interpretador generico do programa pos-fixo
+bool avaliarPrograma(const ProgramaFiltro &filtro, const MovimentacaoConsolidada &mov)
+{
+    double valores[NUM_CAMPOS_FILTRO];
+    carregarValoresFiltro(mov, valores);
+    bool pilha[PROFUNDIDADE_MAXIMA_FILTRO];
+    int topo = 0;
+    for (const auto &inst : filtro.instrucoes)
+    {
+        switch (inst.tipo)
+        {
+        case TipoInstrucao::Comparacao:
+            pilha[topo++] = inst.comparador(valorOperando(inst.esq, valores), valorOperando(inst.dir, valores));
+            break;
+        case TipoInstrucao::Pertence:
+        {
+            const std::vector<double> &lista = filtro.listas[inst.lista];
+            pilha[topo++] = std::binary_search(lista.begin(), lista.end(), valorOperando(inst.esq, valores));
+            break;
+        }
+        case TipoInstrucao::E:
+            --topo;
+            pilha[topo - 1] = pilha[topo - 1] & pilha[topo];
+            break;
+        case TipoInstrucao::Ou:
+            --topo;
+            pilha[topo - 1] = pilha[topo - 1] | pilha[topo];
+            break;
+        case TipoInstrucao::Nao:
+            pilha[topo - 1] = !pilha[topo - 1];
+            break;
+        }
+    }
+    return pilha[0];
+}
+
+template <bool Conjuncao, OpFiltro O1>
+AvaliadorFiltro selecionarSegundoOp(OpFiltro o2)
+{
+    switch (o2)
+    {
+    case OpFiltro::Menor:
+        return &kernelPar<Conjuncao, O1, OpFiltro::Menor>;
+    case OpFiltro::MenorIgual:
+        return &kernelPar<Conjuncao, O1, OpFiltro::MenorIgual>;
+    case OpFiltro::Maior:
+        return &kernelPar<Conjuncao, O1, OpFiltro::Maior>;
+    case OpFiltro::MaiorIgual:
+        return &kernelPar<Conjuncao, O1, OpFiltro::MaiorIgual>;
+    case OpFiltro::Igual:
+        return &kernelPar<Conjuncao, O1, OpFiltro::Igual>;
+    case OpFiltro::Diferente:
+        return &kernelPar<Conjuncao, O1, OpFiltro::Diferente>;
+    }
+    return &avaliarPrograma;
+}
+
+template <bool Conjuncao>
+AvaliadorFiltro selecionarKernelPar(OpFiltro o1, OpFiltro o2)
+{
+    switch (o1)
+    {
+    case OpFiltro::Menor:
+        return selecionarSegundoOp<Conjuncao, OpFiltro::Menor>(o2);
+    case OpFiltro::MenorIgual:
+        return selecionarSegundoOp<Conjuncao, OpFiltro::MenorIgual>(o2);
+    case OpFiltro::Maior:
+        return selecionarSegundoOp<Conjuncao, OpFiltro::Maior>(o2);
+    case OpFiltro::MaiorIgual:
+        return selecionarSegundoOp<Conjuncao, OpFiltro::MaiorIgual>(o2);
+    case OpFiltro::Igual:
+        return selecionarSegundoOp<Conjuncao, OpFiltro::Igual>(o2);
+    case OpFiltro::Diferente:
+        return selecionarSegundoOp<Conjuncao, OpFiltro::Diferente>(o2);
+    }
+    return &avaliarPrograma;
+}
+
+bool (*selecionarComparador(OpFiltro op))(double, double)
+{
+    switch (op)
+    {
+    case OpFiltro::Menor:
+        return &comparar<OpFiltro::Menor>;
+    case OpFiltro::MenorIgual:
+        return &comparar<OpFiltro::MenorIgual>;
+    case OpFiltro::Maior:
+        return &comparar<OpFiltro::Maior>;
+    case OpFiltro::MaiorIgual:
+        return &comparar<OpFiltro::MaiorIgual>;
+    case OpFiltro::Igual:
+        return &comparar<OpFiltro::Igual>;
+    case OpFiltro::Diferente:
+        return &comparar<OpFiltro::Diferente>;
+    }
+    return nullptr;
+}
+
+AvaliadorFiltro selecionarKernelComparacao(OpFiltro op)
+{
+    switch (op)
+    {
+    case OpFiltro::Menor:
+        return &kernelComparacao<OpFiltro::Menor>;
+    case OpFiltro::MenorIgual:
+        return &kernelComparacao<OpFiltro::MenorIgual>;
+    case OpFiltro::Maior:
+        return &kernelComparacao<OpFiltro::Maior>;
+    case OpFiltro::MaiorIgual:
+        return &kernelComparacao<OpFiltro::MaiorIgual>;
+    case OpFiltro::Igual:
+        return &kernelComparacao<OpFiltro::Igual>;
+    case OpFiltro::Diferente:
+        return &kernelComparacao<OpFiltro::Diferente>;
+    }
+    return &avaliarPrograma;
+}
+
+// Verdadeiro para comparacoes "campo op constante", atendidas pelos kernels
+bool comparacaoSimples(const InstrucaoFiltro &inst)
+{
+    return inst.tipo == TipoInstrucao::Comparacao &&
+           inst.esq.num != CAMPO_UM && inst.esq.den == CAMPO_UM && inst.esq.escala == 1.0 &&
+           inst.dir.num == CAMPO_UM && inst.dir.den == CAMPO_UM;
+}
+
+// Escolhe o avaliador mais especifico para o programa ja compilado
+AvaliadorFiltro especializarFiltro(const ProgramaFiltro &filtro)
+{
+    const std::vector<InstrucaoFiltro> &p = filtro.instrucoes;
+    if (p.size() == 1 && comparacaoSimples(p[0]))
+        return selecionarKernelComparacao(p[0].op);
+    if (p.size() == 3 && comparacaoSimples(p[0]) && comparacaoSimples(p[1]))
+    {
+        if (p[2].tipo == TipoInstrucao::E)
+            return selecionarKernelPar<true>(p[0].op, p[1].op);
+        if (p[2].tipo == TipoInstrucao::Ou)
+            return selecionarKernelPar<false>(p[0].op, p[1].op);
+    }
+    return &avaliarPrograma;
+}
+
+InstrucaoFiltro criarComparacao(int campo, OpFiltro op, double limite)
+{
+    InstrucaoFiltro inst;
+    inst.tipo = TipoInstrucao::Comparacao;
+    inst.op = op;
+    inst.comparador = selecionarComparador(op);
+    inst.esq.num = campo;
+    inst.esq.escala = 1.0;
+    inst.dir.escala = limite;
+    return inst;
+}
+
+struct TokenFiltro
+{
+    std::string texto; // Palavras em minusculas, simbolos como lidos
+    double numero = 0.0;
+    bool ehNumero = false;
+};
+
+bool tokenizarFiltro(const std::string &expressao, std::vector<TokenFiltro> &tokens, std::string &erro)
+{
+    size_t i = 0;
+    while (i < expressao.size())
+    {
+        unsigned char c = expressao[i];
+        if (std::isspace(c))
+        {
+            i++;
+            continue;
+        }
+        TokenFiltro tok;
+        bool negativo = c == '-' && i + 1 < expressao.size() && (std::isdigit(static_cast<unsigned char>(expressao[i + 1])) || expressao[i + 1] == '.');
+        if (std::isdigit(c) || c == '.' || negativo)
+        {
+            // Somente decimal, como lerReal faz no CSV: sem hexadecimal nem infinito
+            const char *inicio = expressao.c_str() + i;
+            const char *limite = expressao.c_str() + expressao.size();
+            auto [fim, ec] = std::from_chars(inicio, limite, tok.numero);
+            if (ec != std::errc() || !std::isfinite(tok.numero) ||
+                (fim < limite && (std::isalnum(static_cast<unsigned char>(*fim)) || *fim == '_' || *fim == '.')))
+            {
+                erro = "numero invalido na posicao " + std::to_string(i);
+                return false;
+            }
+            tok.ehNumero = true;
+            tok.texto.assign(inicio, fim - inicio);
+            i += fim - inicio;
+        }
+        else if (std::isalpha(c) || c == '_')
+        {
+            while (i < expressao.size() && (std::isalnum(static_cast<unsigned char>(expressao[i])) || expressao[i] == '_'))
+                tok.texto += static_cast<char>(std::tolower(static_cast<unsigned char>(expressao[i++])));
+        }
+        else
+        {
+            static const char *simbolos[] = {">=", "<=", "==", "!=", "&&", "||", ">", "<", "=", "!", "(", ")", ",", "/"};
+            for (const char *s : simbolos)
+            {
+                if (expressao.compare(i, std::strlen(s), s) == 0)
+                {
+                    tok.texto = s;
+                    break;
+                }
+            }
+            if (tok.texto.empty())
+            {
+                erro = std::string("caractere inesperado '") + expressao[i] + "' na posicao " + std::to_string(i);
+                return false;
+            }
+            i += tok.texto.size();
+        }
+        tokens.push_back(tok);
+    }
+    return true;
+}
+
+const int ANINHAMENTO_MAXIMO_FILTRO = 256;
+
+struct ParserFiltro
+{
+    std::vector<TokenFiltro> tokens;
+    size_t pos = 0;
+    int profundidade = 0;
+    int profundidadeMaxima = 0;
+    int aninhamento = 0; // Fatores abertos na recursao (parenteses e NAO)
+    ProgramaFiltro programa;
+    std::string erro;
+};
+
+bool fimTokens(const ParserFiltro &p)
+{
+    return p.pos >= p.tokens.size();
+}
+
+bool aceitar(ParserFiltro &p, const char *a, const char *b = nullptr)
+{
+    if (fimTokens(p) || p.tokens[p.pos].ehNumero)
+        return false;
+    const std::string &t = p.tokens[p.pos].texto;
+    if (t == a || (b && t == b))
+    {
+        p.pos++;
+        return true;
+    }
+    return false;
+}
+
+bool falhar(ParserFiltro &p, const std::string &mensagem)
+{
+    if (p.erro.empty())
+        p.erro = mensagem + (fimTokens(p) ? " no fim da expressao" : " perto de '" + p.tokens[p.pos].texto + "'");
+    return false;
+}
+
+void emitir(ParserFiltro &p, const InstrucaoFiltro &inst)
+{
+    if (inst.tipo == TipoInstrucao::Comparacao || inst.tipo == TipoInstrucao::Pertence)
+        p.profundidade++;
+    else if (inst.tipo != TipoInstrucao::Nao)
+        p.profundidade--;
+    p.profundidadeMaxima = std::max(p.profundidadeMaxima, p.profundidade);
+    p.programa.instrucoes.push_back(inst);
+}
+
+bool lerNumero(ParserFiltro &p, double &valor)
+{
+    if (fimTokens(p) || !p.tokens[p.pos].ehNumero)
+        return falhar(p, "numero esperado");
+    valor = p.tokens[p.pos++].numero;
+    return true;
+}
+
+bool lerPrimario(ParserFiltro &p, int &campo, double &escala)
+{
+    if (fimTokens(p))
+        return falhar(p, "campo ou numero esperado");
+    const TokenFiltro &tok = p.tokens[p.pos];
+    if (tok.ehNumero)
+    {
+        campo = CAMPO_UM;
+        escala = tok.numero;
+        p.pos++;
+        return true;
+    }
+    static const std::map<std::string, int> campos = {
+        {"especie", CAMPO_ESPECIE},
+        {"eletronica", CAMPO_ELETRONICA},
+        {"total", CAMPO_TOTAL},
+        {"total_transacoes", CAMPO_TOTAL_TRANSACOES},
+        {"transacoes", CAMPO_TOTAL_TRANSACOES},
+        {"agencia", CAMPO_AGENCIA},
+        {"conta", CAMPO_CONTA}};
+    auto it = campos.find(tok.texto);
+    if (it == campos.end())
+        return falhar(p, "campo desconhecido");
+    campo = it->second;
+    escala = 1.0;
+    p.pos++;
+    return true;
+}
+
+// operando := primario [ '/' primario ]
+bool lerOperando(ParserFiltro &p, OperandoFiltro &o)
+{
+    if (!lerPrimario(p, o.num, o.escala))
+        return false;
+    if (aceitar(p, "/"))
+    {
+        int den;
+        double escalaDen;
+        size_t posDen = p.pos;
+        if (!lerPrimario(p, den, escalaDen))
+            return false;
+        if (escalaDen == 0.0)
+        {
+            p.pos = posDen; // Aponta o erro para o divisor
+            return falhar(p, "divisao por zero");
+        }
+        o.den = den;
+        o.escala /= escalaDen;
+    }
+    return true;
+}
+
+bool lerOpComparacao(ParserFiltro &p, OpFiltro &op)
+{
+    if (aceitar(p, ">="))
+        op = OpFiltro::MaiorIgual;
+    else if (aceitar(p, "<="))
+        op = OpFiltro::MenorIgual;
+    else if (aceitar(p, ">"))
+        op = OpFiltro::Maior;
+    else if (aceitar(p, "<"))
+        op = OpFiltro::Menor;
+    else if (aceitar(p, "==", "="))
+        op = OpFiltro::Igual;
+    else if (aceitar(p, "!="))
+        op = OpFiltro::Diferente;
+    else
+        return falhar(p, "operador de comparacao esperado");
+    return true;
+}
+
+OpFiltro espelharOp(OpFiltro op)
+{
+    switch (op)
+    {
+    case OpFiltro::Menor:
+        return OpFiltro::Maior;
+    case OpFiltro::MenorIgual:
+        return OpFiltro::MaiorIgual;
+    case OpFiltro::Maior:
+        return OpFiltro::Menor;
+    case OpFiltro::MaiorIgual:
+        return OpFiltro::MenorIgual;
+    default:
+        return op;
+    }
+}
+
+bool lerOu(ParserFiltro &p);
+
+bool lerFatorSemLimite(ParserFiltro &p);
+
+// Limita a recursao do parser para que entradas como "((((..." falhem em vez de estourar a pilha
+bool lerFator(ParserFiltro &p)
+{
+    if (++p.aninhamento > ANINHAMENTO_MAXIMO_FILTRO)
+    {
+        if (p.erro.empty())
+            p.erro = "expressao muito complexa";
+        return false;
+    }
+    bool ok = lerFatorSemLimite(p);
+    p.aninhamento--;
+    return ok;
+}
+
+// fator := NAO fator | '(' expr ')' | operando ENTRE num num | operando EM '(' num {, num} ')' | operando op operando
+bool lerFatorSemLimite(ParserFiltro &p)
+{
+    if (aceitar(p, "nao", "not") || aceitar(p, "!"))
+    {
+        if (!lerFator(p))
+            return false;
+        InstrucaoFiltro inst;
+        inst.tipo = TipoInstrucao::Nao;
+        emitir(p, inst);
+        return true;
+    }
+    if (aceitar(p, "("))
+    {
+        if (!lerOu(p))
+            return false;
+        if (!aceitar(p, ")"))
+            return falhar(p, "')' esperado");
+        return true;
+    }
+
+    OperandoFiltro esq;
+    if (!lerOperando(p, esq))
+        return false;
+
+    if (aceitar(p, "entre", "between"))
+    {
+        double minimo, maximo;
+        if (!lerNumero(p, minimo))
+            return false;
+        aceitar(p, "e", "and");
+        if (!lerNumero(p, maximo))
+            return false;
+        InstrucaoFiltro inferior = criarComparacao(CAMPO_UM, OpFiltro::MaiorIgual, minimo);
+        inferior.esq = esq;
+        InstrucaoFiltro superior = criarComparacao(CAMPO_UM, OpFiltro::MenorIgual, maximo);
+        superior.esq = esq;
+        InstrucaoFiltro juncao;
+        juncao.tipo = TipoInstrucao::E;
+        emitir(p, inferior);
+        emitir(p, superior);
+        emitir(p, juncao);
+        return true;
+    }
+
+    if (aceitar(p, "em", "in"))
+    {
+        if (!aceitar(p, "("))
+            return falhar(p, "'(' esperado");
+        std::vector<double> lista;
+        do
+        {
+            double valor;
+            if (!lerNumero(p, valor))
+                return false;
+            lista.push_back(valor);
+        } while (aceitar(p, ","));
+        if (!aceitar(p, ")"))
+            return falhar(p, "')' esperado");
+        std::sort(lista.begin(), lista.end());
+        InstrucaoFiltro inst;
+        inst.tipo = TipoInstrucao::Pertence;
+        inst.esq = esq;
+        inst.lista = static_cast<int>(p.programa.listas.size());
+        p.programa.listas.push_back(lista);
+        emitir(p, inst);
+        return true;
+    }
+
+    OpFiltro op = OpFiltro::MaiorIgual;
+    OperandoFiltro dir;
+    if (!lerOpComparacao(p, op) || !lerOperando(p, dir))
+        return false;
+    // "100 <= especie" vira "especie >= 100" para cair nos kernels especializados
+    if (esq.num == CAMPO_UM && esq.den == CAMPO_UM && !(dir.num == CAMPO_UM && dir.den == CAMPO_UM))
+    {
+        std::swap(esq, dir);
+        op = espelharOp(op);
+    }
+    InstrucaoFiltro inst = criarComparacao(CAMPO_UM, op, 0.0);
+    inst.esq = esq;
+    inst.dir = dir;
+    emitir(p, inst);
+    return true;
+}
+
+// termo := fator { E fator }
+bool lerE(ParserFiltro &p)
+{
+    if (!lerFator(p))
+        return false;
+    while (aceitar(p, "e", "and") || aceitar(p, "&&"))
+    {
+        if (!lerFator(p))
+            return false;
+        InstrucaoFiltro inst;
+        inst.tipo = TipoInstrucao::E;
+        emitir(p, inst);
+    }
+    return true;
+}
+
+// expr := termo { OU termo }
+bool lerOu(ParserFiltro &p)
+{
+    if (!lerE(p))
+        return false;
+    while (aceitar(p, "ou", "or") || aceitar(p, "||"))
+    {
+        if (!lerE(p))
+            return false;
+        InstrucaoFiltro inst;
+        inst.tipo = TipoInstrucao::Ou;
+        emitir(p, inst);
+    }
+    return true;
+}
+
+} // namespace
+
+FiltroCompilado::FiltroCompilado()
+    : programa(std::make_shared<const ProgramaFiltro>()), avaliar(&aceitarTodas)
+{
+}
+
+FiltroCompilado::FiltroCompilado(std::shared_ptr<const ProgramaFiltro> programa, AvaliadorFiltro avaliar)
+    : programa(std::move(programa)), avaliar(avaliar)
+{
+}
+
+FiltroCompilado criarFiltroLimiar(double x, double y, bool conjuncao)
+{
+    auto programa = std::make_shared<ProgramaFiltro>();
+    programa->instrucoes.push_back(criarComparacao(CAMPO_ESPECIE, OpFiltro::MaiorIgual, x));
+    programa->instrucoes.push_back(criarComparacao(CAMPO_ELETRONICA, OpFiltro::MaiorIgual, y));
+    InstrucaoFiltro juncao;
+    juncao.tipo = conjuncao ? TipoInstrucao::E : TipoInstrucao::Ou;
+    programa->instrucoes.push_back(juncao);
+    AvaliadorFiltro avaliar = especializarFiltro(*programa);
+    return FiltroCompilado(std::move(programa), avaliar);
+}
+
+bool compilarFiltro(const std::string &expressao, FiltroCompilado &filtro, std::string &erro)
+{
+    ParserFiltro p;
+    if (!tokenizarFiltro(expressao, p.tokens, erro))
+        return false;
+    if (lerOu(p) && !fimTokens(p))
+        falhar(p, "token inesperado");
+    if (!p.erro.empty())
+    {
+        erro = p.erro;
+        return false;
+    }
+    if (p.profundidadeMaxima > PROFUNDIDADE_MAXIMA_FILTRO)
+    {
+        erro = "expressao muito complexa";
+        return false;
+    }
+    auto programa = std::make_shared<ProgramaFiltro>(std::move(p.programa));
+    AvaliadorFiltro avaliar = especializarFiltro(*programa);
+    filtro = FiltroCompilado(std::move(programa), avaliar);
+    return true;
+}
+
+} // namespace consolidacao
\ No newline at end of file
@@ -0,0 +1,251 @@
+// Biblioteca de consolidacao de transacoes: parser validador, consolidacao
+// (sequencial ou em pipeline), leitura/escrita do arquivo consolidado e filtros.
+// Nenhuma funcao imprime; os resultados sao expostos como visoes sobre memoria
+// contigua, alocada pelo memory_resource escolhido pelo chamador.
+//
+// Compilacao: "make" gera libconsolidacao.a e o programa trab ligado a ela
+#ifndef CONSOLIDACAO_H
+#define CONSOLIDACAO_H
+
+#include <cstddef>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace consolidacao
+{
+
+struct Transacao
+{
+    int dia, mes, ano;
+    int agencia_origem, conta_origem;
+    double valor;
+    int agencia_destino, conta_destino;
+};
+
+struct MovimentacaoConsolidada
+{
+    int agencia, conta;
+    double subtotal_especie = 0.0;
+    double subtotal_eletronica = 0.0;
+    int total_transacoes = 0;
+};
+
+// ---- Parser validador ----
+
+enum class ErroLinha
+{
+    Nenhum,
+    LinhaVazia,
+    CamposFaltando,
+    CamposSobrando,
+    NaoNumerico,
+    ForaDoIntervalo
+};
+
+const int NUM_ERROS_LINHA = 6;
+const int NUM_CAMPOS_TRANSACAO = 8;
+const int CONTA_MAXIMA = 999999;  // Contas ocupam os 6 digitos baixos da chave
+const int AGENCIA_MAXIMA = 2146; // Maior agencia cuja chave ainda cabe em int
+
+struct LinhaRejeitada
+{
+    long long offset; // Posicao da linha no arquivo, em bytes
+    ErroLinha erro;
+    int campo;
+    std::string conteudo;
+};
+
+struct Quarentena
+{
+    std::string caminho;   // Vazio: somente conta as rejeicoes
+    std::ofstream arquivo; // Aberto somente na primeira rejeicao
+    long long aceitas = 0, rejeitadas = 0;
+    long long porErro[NUM_ERROS_LINHA] = {};
+};
+
+const char *descreverErroLinha(ErroLinha erro);
+const char *nomeCampoTransacao(int campo);
+
+// Valida e converte uma linha "dia,mes,ano,agencia,conta,valor,agencia_destino,conta_destino".
+// Destino vazio indica transacao em especie. Em caso de erro, campoErro indica o campo.
+ErroLinha validarTransacao(const char *inicio, const char *fim, Transacao &t, int &campoErro);
+
+// Zera as contagens e apaga o arquivo de uma carga anterior; chamada no inicio de cada carga
+void reiniciarQuarentena(Quarentena &q);
+void registrarRejeitada(Quarentena &q, const LinhaRejeitada &r);
+std::string resumirQuarentena(const Quarentena &q);
+
+// Retorna false se o arquivo nao puder ser aberto ou a leitura falhar
+bool carregarTransacoes(const std::string &arquivoCSV, std::pmr::vector<Transacao> &transacoes, Quarentena &quarentena);
+
+// ---- Consolidacao ----
+
+// Acumulador por agencia e conta (chave agencia * 1000000 + conta)
+using MapaConsolidacao = std::pmr::map<int, MovimentacaoConsolidada>;
+
+// Visao somente leitura sobre movimentacoes contiguas, sem copia
+struct VisaoMovimentacoes
+{
+    const MovimentacaoConsolidada *inicio = nullptr;
+    const MovimentacaoConsolidada *fim = nullptr;
+
+    const MovimentacaoConsolidada *begin() const { return inicio; }
+    const MovimentacaoConsolidada *end() const { return fim; }
+    size_t size() const { return fim - inicio; }
+    bool empty() const { return inicio == fim; }
+    const MovimentacaoConsolidada &operator[](size_t i) const { return inicio[i]; }
+};
+
+// Movimentacoes consolidadas em ordem de agencia e conta
+struct ResultadoConsolidacao
+{
+    explicit ResultadoConsolidacao(std::pmr::memory_resource *recurso = std::pmr::get_default_resource())
+        : movimentacoes(recurso) {}
+
+    std::pmr::vector<MovimentacaoConsolidada> movimentacoes;
+
+    VisaoMovimentacoes visao() const
+    {
+        return {movimentacoes.data(), movimentacoes.data() + movimentacoes.size()};
+    }
+};
+
+void consolidarMovimentacao(const Transacao *transacoes, size_t quantidade, int mes, int ano, MapaConsolidacao &consolidacao);
+
+// Ajustes da ingestao em pipeline; zero escolhe o padrao
+struct OpcoesPipeline
+{
+    size_t tamanhoBloco = 0; // Bytes por leitura (padrao 1 MiB)
+    int numParsers = 0;      // Threads de parse (padrao: nucleos disponiveis)
+};
+
+// Equivalente a carregarTransacoes + consolidarMovimentacao, com leitura, parse e
+// agregacao sobrepostos. A thread chamadora faz a agregacao, na ordem do arquivo,
+// de modo que o resultado e identico ao do caminho sequencial.
+bool consolidarMovimentacaoPipeline(const std::string &arquivoCSV, int mes, int ano, MapaConsolidacao &consolidacao,
+                                    Quarentena &quarentena, bool &usouIoUring, const OpcoesPipeline &opcoes = OpcoesPipeline());
+
+// Copia o acumulador para o vetor contiguo do resultado
+void finalizarConsolidacao(const MapaConsolidacao &consolidacao, ResultadoConsolidacao &resultado);
+
+// ---- Arquivo consolidado ----
+
+// Nome padrao do arquivo de um mes, sem diretorio; o chamador escolhe onde grava-lo
+std::string nomeArquivoConsolidacao(int mes, int ano);
+void salvarConsolidacaoBinaria(VisaoMovimentacoes movimentacoes, const std::string &caminho);
+// Falha se o arquivo nao existir, estiver truncado ou nao for multiplo do registro
+bool carregarConsolidacaoBinaria(ResultadoConsolidacao &resultado, const std::string &caminho);
+
+// ---- Filtros ----
+
+// Programa compilado; definido somente em consolidacao.cpp
+struct ProgramaFiltro;
+using AvaliadorFiltro = bool (*)(const ProgramaFiltro &, const MovimentacaoConsolidada &);
+
+// Filtro opaco, obtido de compilarFiltro ou criarFiltroLimiar. Copias
+// compartilham o mesmo programa imutavel.
+class FiltroCompilado
+{
+public:
+    // Filtro vazio: aceita todas as movimentacoes
+    FiltroCompilado();
+
+    bool aceita(const MovimentacaoConsolidada &mov) const { return avaliar(*programa, mov); }
+
+private:
+    FiltroCompilado(std::shared_ptr<const ProgramaFiltro> programa, AvaliadorFiltro avaliar);
+
+    friend bool compilarFiltro(const std::string &expressao, FiltroCompilado &filtro, std::string &erro);
+    friend FiltroCompilado criarFiltroLimiar(double x, double y, bool conjuncao);
+
+    std::shared_ptr<const ProgramaFiltro> programa;
+    AvaliadorFiltro avaliar;
+};
+
+// Compila uma expressao como "especie >= 100 E NAO agencia EM (1, 2)".
+// Campos: especie, eletronica, total, total_transacoes, agencia, conta.
+// Em caso de erro, filtro nao e alterado.
+bool compilarFiltro(const std::string &expressao, FiltroCompilado &filtro, std::string &erro);
+
+// Filtro equivalente ao antigo "especie >= X E/OU eletronica >= Y"
+FiltroCompilado criarFiltroLimiar(double x, double y, bool conjuncao);
+
+inline bool aplicarFiltro(const FiltroCompilado &filtro, const MovimentacaoConsolidada &mov)
+{
+    return filtro.aceita(mov);
+}
+
+// Visao que percorre somente as movimentacoes aceitas pelo filtro, sem copia das
+// movimentacoes. A visao guarda sua propria copia (barata) do filtro.
+class VisaoFiltrada
+{
+public:
+    class Iterador
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = MovimentacaoConsolidada;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const MovimentacaoConsolidada *;
+        using reference = const MovimentacaoConsolidada &;
+
+        Iterador() : atual(nullptr), fim(nullptr), filtro(nullptr) {}
+        Iterador(const MovimentacaoConsolidada *atual, const MovimentacaoConsolidada *fim, const FiltroCompilado *filtro)
+            : atual(atual), fim(fim), filtro(filtro)
+        {
+            avancar();
+        }
+
+        const MovimentacaoConsolidada &operator*() const { return *atual; }
+        const MovimentacaoConsolidada *operator->() const { return atual; }
+        Iterador &operator++()
+        {
+            ++atual;
+            avancar();
+            return *this;
+        }
+        Iterador operator++(int)
+        {
+            Iterador anterior = *this;
+            ++*this;
+            return anterior;
+        }
+        bool operator==(const Iterador &outro) const { return atual == outro.atual; }
+        bool operator!=(const Iterador &outro) const { return atual != outro.atual; }
+
+    private:
+        void avancar()
+        {
+            while (atual != fim && !aplicarFiltro(*filtro, *atual))
+                ++atual;
+        }
+
+        const MovimentacaoConsolidada *atual;
+        const MovimentacaoConsolidada *fim;
+        const FiltroCompilado *filtro;
+    };
+
+    VisaoFiltrada(VisaoMovimentacoes base, FiltroCompilado filtro) : base(base), filtro(std::move(filtro)) {}
+
+    Iterador begin() const { return Iterador(base.inicio, base.fim, &filtro); }
+    Iterador end() const { return Iterador(base.fim, base.fim, &filtro); }
+
+private:
+    VisaoMovimentacoes base;
+    FiltroCompilado filtro;
+};
+
+inline VisaoFiltrada filtrar(VisaoMovimentacoes movimentacoes, const FiltroCompilado &filtro)
+{
+    return VisaoFiltrada(movimentacoes, filtro);
+}
+
+} // namespace consolidacao
+
+#endif
\ No newline at end of file
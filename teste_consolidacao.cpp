@@ -0,0 +1,322 @@
+// Testes da biblioteca de consolidacao: "make teste" compila e executa.
+// Sai com codigo diferente de zero se alguma verificacao falhar.
+#include "consolidacao.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+using namespace consolidacao;
+
+namespace
+{
+
+int falhas = 0;
+
+void verificar(bool condicao, const std::string &descricao)
+{
+    if (!condicao)
+    {
+        std::cerr << "FALHOU: " << descricao << std::endl;
+        falhas++;
+    }
+}
+
+MovimentacaoConsolidada movimentacao(int agencia, int conta, double especie, double eletronica, int transacoes)
+{
+    MovimentacaoConsolidada mov;
+    mov.agencia = agencia;
+    mov.conta = conta;
+    mov.subtotal_especie = especie;
+    mov.subtotal_eletronica = eletronica;
+    mov.total_transacoes = transacoes;
+    return mov;
+}
+
+// Compila a expressao e verifica o resultado para mov
+void verificarFiltro(const std::string &expressao, const MovimentacaoConsolidada &mov, bool esperado)
+{
+    FiltroCompilado filtro;
+    std::string erro;
+    if (!compilarFiltro(expressao, filtro, erro))
+    {
+        verificar(false, "'" + expressao + "' nao compilou: " + erro);
+        return;
+    }
+    verificar(filtro.aceita(mov) == esperado, "'" + expressao + "' deveria " + (esperado ? "aceitar" : "rejeitar"));
+}
+
+// Verifica que a expressao falha com uma mensagem que contem trecho
+void verificarErroFiltro(const std::string &expressao, const std::string &trecho)
+{
+    FiltroCompilado filtro;
+    std::string erro;
+    bool ok = compilarFiltro(expressao, filtro, erro);
+    verificar(!ok && erro.find(trecho) != std::string::npos,
+              "'" + expressao.substr(0, 40) + "' deveria falhar com '" + trecho + "', obteve '" + (ok ? "ok" : erro) + "'");
+}
+
+void testarFiltros()
+{
+    MovimentacaoConsolidada a = movimentacao(1, 2, 150, 0, 4);
+    MovimentacaoConsolidada b = movimentacao(3, 1, 60, 40, 2);
+
+    // E tem precedencia sobre OU; parenteses mudam o agrupamento
+    verificarFiltro("especie >= 100 OU eletronica >= 100 E conta == 1", a, true);
+    verificarFiltro("(especie >= 100 OU eletronica >= 100) E conta == 1", a, false);
+    verificarFiltro("conta == 1 E eletronica >= 100 OU especie >= 100", a, true);
+    verificarFiltro("especie >= 1 and conta = 2 && transacoes > 3 || agencia == 9", a, true);
+
+    // NAO se aplica ao fator seguinte
+    verificarFiltro("NAO especie >= 100", a, false);
+    verificarFiltro("NAO especie >= 100 OU conta == 2", a, true);
+    verificarFiltro("NAO (especie >= 100 OU conta == 2)", a, false);
+    verificarFiltro("NAO NAO especie >= 100", a, true);
+
+    // ENTRE inclui os limites
+    verificarFiltro("especie ENTRE 60 E 100", b, true);
+    verificarFiltro("especie ENTRE 10 60", b, true);
+    verificarFiltro("especie ENTRE 61 E 100", b, false);
+    verificarFiltro("total ENTRE 100 E 100", b, true);
+
+    // EM aceita a lista em qualquer ordem
+    verificarFiltro("agencia EM (5, 3, 1)", b, true);
+    verificarFiltro("agencia EM (1, 2)", b, false);
+    verificarFiltro("especie >= 100 E NAO agencia EM (2, 3)", a, true);
+
+    // Razoes entre campos e constante a esquerda
+    verificarFiltro("especie / total >= 0.6", b, true);
+    verificarFiltro("eletronica / total >= 0.6", b, false);
+    verificarFiltro("especie / eletronica > 1.4", b, true);
+    verificarFiltro("total / 2 == 50", b, true);
+    verificarFiltro("100 <= especie", a, true);
+    verificarFiltro("100 > especie", a, false);
+
+    // Formato antigo "X Y E/OU"
+    verificar(criarFiltroLimiar(100, 0, true).aceita(a), "limiar E deveria aceitar");
+    verificar(!criarFiltroLimiar(100, 50, true).aceita(a), "limiar E deveria rejeitar");
+    verificar(criarFiltroLimiar(100, 50, false).aceita(a), "limiar OU deveria aceitar");
+    verificar(!criarFiltroLimiar(200, 50, false).aceita(a), "limiar OU deveria rejeitar");
+
+    // Filtro vazio aceita tudo; compilacao com erro nao altera o filtro
+    FiltroCompilado filtro;
+    std::string erro;
+    verificar(filtro.aceita(a) && filtro.aceita(b), "filtro vazio deveria aceitar tudo");
+    verificar(compilarFiltro("especie >= 100", filtro, erro), "compilacao valida falhou");
+    verificar(!compilarFiltro("especie >=", filtro, erro), "compilacao invalida deveria falhar");
+    verificar(filtro.aceita(a) && !filtro.aceita(b), "filtro alterado por compilacao com erro");
+
+    // Erros
+    verificarErroFiltro("", "campo ou numero esperado no fim da expressao");
+    verificarErroFiltro("especie >=", "no fim da expressao");
+    verificarErroFiltro("saldo >= 1", "campo desconhecido perto de 'saldo'");
+    verificarErroFiltro("especie 100", "operador de comparacao esperado");
+    verificarErroFiltro("(especie >= 1", "')' esperado");
+    verificarErroFiltro("agencia EM 1, 2", "'(' esperado");
+    verificarErroFiltro("especie ENTRE 1 E conta", "numero esperado");
+    verificarErroFiltro("especie / 0 >= 1", "divisao por zero perto de '0'");
+    verificarErroFiltro("especie >= 1e400", "numero invalido");
+    verificarErroFiltro("especie >= 0x10", "numero invalido");
+    verificarErroFiltro("especie >= 1 $", "caractere inesperado");
+    verificarErroFiltro("especie >= 1 )", "token inesperado");
+
+    // Limite de profundidade: aninhamento excessivo falha sem estourar a pilha
+    verificarErroFiltro(std::string(100000, '(') + "especie >= 1", "expressao muito complexa");
+    std::string naos;
+    for (int i = 0; i < 100000; i++)
+        naos += "NAO ";
+    verificarErroFiltro(naos + "especie >= 1", "expressao muito complexa");
+    std::string parenteses = std::string(100, '(') + "especie >= 100" + std::string(100, ')');
+    verificarFiltro(parenteses, a, true);
+    // Cadeias longas e planas nao aninham e continuam validas
+    std::string cadeia = "especie >= 1";
+    for (int i = 0; i < 10000; i++)
+        cadeia += " E conta == 2";
+    verificarFiltro(cadeia, a, true);
+}
+
+// Valida a linha e confere o codigo e o campo reportados
+void verificarLinha(const char *linha, ErroLinha esperado, int campoEsperado)
+{
+    Transacao t;
+    int campo;
+    ErroLinha erro = validarTransacao(linha, linha + std::strlen(linha), t, campo);
+    verificar(erro == esperado && (erro == ErroLinha::Nenhum || campo == campoEsperado),
+              "'" + std::string(linha) + "': esperado " + descreverErroLinha(esperado) + " em " + nomeCampoTransacao(campoEsperado) +
+                  ", obtido " + descreverErroLinha(erro) + " em " + nomeCampoTransacao(campo));
+}
+
+void testarValidador()
+{
+    verificarLinha("", ErroLinha::LinhaVazia, -1);
+    verificarLinha("\r", ErroLinha::LinhaVazia, -1);
+
+    verificarLinha("1,3,2024,1,1,5", ErroLinha::CamposFaltando, 6);
+    verificarLinha("1,3,2024,1,1,5,2", ErroLinha::CamposFaltando, 7);
+    verificarLinha("lixo", ErroLinha::CamposFaltando, 1);
+    verificarLinha("1,3,2024,1,1,5,,,9", ErroLinha::CamposSobrando, -1);
+
+    verificarLinha("x,3,2024,1,1,5,,", ErroLinha::NaoNumerico, 0);
+    verificarLinha("1,3,2024,,1,5,,", ErroLinha::NaoNumerico, 3);
+    verificarLinha("1,3,2024,1,1x,5,,", ErroLinha::NaoNumerico, 4);
+    verificarLinha("1,3,2024,1,1,abc,,", ErroLinha::NaoNumerico, 5);
+    verificarLinha("1,3,2024,1,1,+-5,,", ErroLinha::NaoNumerico, 5);
+    verificarLinha("1,3,2024,1,1,++5,,", ErroLinha::NaoNumerico, 5);
+    verificarLinha("1,3,2024,1,1,+,,", ErroLinha::NaoNumerico, 5);
+    verificarLinha("1,3,2024,1,1,5,2,y", ErroLinha::NaoNumerico, 7);
+
+    verificarLinha("32,3,2024,1,1,5,,", ErroLinha::ForaDoIntervalo, 0);
+    verificarLinha("1,13,2024,1,1,5,,", ErroLinha::ForaDoIntervalo, 1);
+    verificarLinha("1,3,99999999999,1,1,5,,", ErroLinha::ForaDoIntervalo, 2);
+    verificarLinha("1,3,2024,2147,1,5,,", ErroLinha::ForaDoIntervalo, 3);
+    verificarLinha("1,3,2024,-1,1,5,,", ErroLinha::ForaDoIntervalo, 3);
+    verificarLinha("1,3,2024,1,1000000,5,,", ErroLinha::ForaDoIntervalo, 4);
+    verificarLinha("1,3,2024,1,1,1e400,,", ErroLinha::ForaDoIntervalo, 5);
+
+    verificarLinha("1,3,2024,2146,999999,5,,", ErroLinha::Nenhum, -1);
+    verificarLinha("1,3,2024,1,1,5,2,3\r", ErroLinha::Nenhum, -1);
+
+    // Espacos ao redor dos campos e '+' antes de digito sao aceitos; destino vazio e especie
+    const char *linha = " 7 , 3 ,2024,+12,\t34, +.5 ,,";
+    Transacao t;
+    int campo;
+    verificar(validarTransacao(linha, linha + std::strlen(linha), t, campo) == ErroLinha::Nenhum && t.dia == 7 && t.mes == 3 &&
+                  t.ano == 2024 && t.agencia_origem == 12 && t.conta_origem == 34 && t.valor == 0.5 && t.agencia_destino == 0 &&
+                  t.conta_destino == 0,
+              "linha com espacos e '+' convertida incorretamente");
+
+    // Sem caminho, a quarentena somente conta as rejeicoes
+    Quarentena quarentena;
+    registrarRejeitada(quarentena, {0, ErroLinha::NaoNumerico, 5, "1,3,2024,1,1,abc,,"});
+    registrarRejeitada(quarentena, {19, ErroLinha::LinhaVazia, -1, ""});
+    verificar(quarentena.rejeitadas == 2 && quarentena.porErro[static_cast<int>(ErroLinha::NaoNumerico)] == 1 &&
+                  !quarentena.arquivo.is_open(),
+              "quarentena sem caminho deveria somente contar");
+    verificar(resumirQuarentena(quarentena) == "0 linhas aceitas, 2 rejeitadas (linha vazia: 1, campo nao numerico: 1)",
+              "resumo da quarentena: " + resumirQuarentena(quarentena));
+}
+
+std::string lerArquivo(const std::string &caminho)
+{
+    std::ifstream arquivo(caminho, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(arquivo), std::istreambuf_iterator<char>());
+}
+
+// CSV deterministico com valores de muitas casas (a ordem das somas importa),
+// linhas invalidas, CRLF, linha maior que a folga do pipeline e sem quebra final
+void gerarCSV(const std::string &caminho)
+{
+    std::ofstream arquivo(caminho, std::ios::binary);
+    unsigned semente = 12345;
+    auto sortear = [&semente](unsigned limite) {
+        semente = semente * 1103515245u + 12345u;
+        return (semente >> 8) % limite;
+    };
+    for (int i = 0; i < 40000; i++)
+    {
+        unsigned tipo = sortear(1000);
+        if (tipo < 3)
+            arquivo << "lixo," << i << '\n';
+        else if (tipo < 5)
+            arquivo << '\n';
+        else if (tipo < 7)
+            arquivo << "1,3,2024,1,x,2,,\n";
+        else if (i == 20000)
+            arquivo << "1,3,2024,1,1," << std::string(70000, '9') << ",,\n";
+        else
+        {
+            arquivo << 1 + sortear(28) << ',' << (tipo < 900 ? 3 : 4) << ",2024," << 1 + sortear(20) << ',' << 1 + sortear(30) << ','
+                    << sortear(100000) << '.' << sortear(1000000) << ',';
+            if (sortear(2))
+                arquivo << 1 + sortear(5) << ',' << 1 + sortear(50);
+            else
+                arquivo << ',';
+            arquivo << (tipo < 100 ? "\r\n" : "\n");
+        }
+    }
+    arquivo << "2,3,2024,7,7,1.25,,";
+}
+
+bool mapasIguais(const MapaConsolidacao &a, const MapaConsolidacao &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j)
+    {
+        const MovimentacaoConsolidada &x = i->second, &y = j->second;
+        // Comparacao exata: o pipeline precisa somar na mesma ordem que o caminho sequencial
+        if (i->first != j->first || x.agencia != y.agencia || x.conta != y.conta || x.subtotal_especie != y.subtotal_especie ||
+            x.subtotal_eletronica != y.subtotal_eletronica || x.total_transacoes != y.total_transacoes)
+            return false;
+    }
+    return true;
+}
+
+void testarPipeline()
+{
+    const std::string csv = "teste_pipeline.csv";
+    gerarCSV(csv);
+
+    Quarentena sequencial;
+    sequencial.caminho = "teste_quarentena_seq.csv";
+    std::pmr::vector<Transacao> transacoes;
+    MapaConsolidacao esperado;
+    verificar(carregarTransacoes(csv, transacoes, sequencial), "carregarTransacoes falhou");
+    consolidarMovimentacao(transacoes.data(), transacoes.size(), 3, 2024, esperado);
+    sequencial.arquivo.close();
+    std::string quarentenaEsperada = lerArquivo(sequencial.caminho);
+    verificar(sequencial.rejeitadas > 0 && !esperado.empty(), "CSV de teste deveria ter linhas aceitas e rejeitadas");
+
+    // Blocos pequenos (inclusive menores que uma linha) e varios parsers embaralham a
+    // ordem em que os lotes ficam prontos
+    OpcoesPipeline configuracoes[] = {{0, 0}, {4096, 6}, {4096, 1}, {37, 4}};
+    for (const OpcoesPipeline &opcoes : configuracoes)
+    {
+        for (int execucao = 0; execucao < 3; execucao++)
+        {
+            std::string descricao = "pipeline com blocos de " + std::to_string(opcoes.tamanhoBloco) + " bytes e " +
+                                    std::to_string(opcoes.numParsers) + " parsers";
+            Quarentena quarentena;
+            quarentena.caminho = "teste_quarentena_pipeline.csv";
+            MapaConsolidacao obtido;
+            bool usouIoUring;
+            verificar(consolidarMovimentacaoPipeline(csv, 3, 2024, obtido, quarentena, usouIoUring, opcoes), descricao + " falhou");
+            quarentena.arquivo.close();
+            verificar(mapasIguais(obtido, esperado), descricao + ": consolidacao difere da sequencial");
+            verificar(quarentena.aceitas == sequencial.aceitas && quarentena.rejeitadas == sequencial.rejeitadas,
+                      descricao + ": contagens diferem da sequencial");
+            verificar(lerArquivo(quarentena.caminho) == quarentenaEsperada, descricao + ": quarentena difere da sequencial");
+        }
+    }
+
+    // Arquivo inexistente falha nos dois caminhos
+    Quarentena quarentena;
+    MapaConsolidacao vazio;
+    bool usouIoUring;
+    verificar(!carregarTransacoes("teste_inexistente.csv", transacoes, quarentena), "carregarTransacoes deveria falhar");
+    verificar(!consolidarMovimentacaoPipeline("teste_inexistente.csv", 3, 2024, vazio, quarentena, usouIoUring),
+              "pipeline deveria falhar");
+
+    std::remove(csv.c_str());
+    std::remove("teste_quarentena_seq.csv");
+    std::remove("teste_quarentena_pipeline.csv");
+}
+
+} // namespace
+
+int main()
+{
+    testarFiltros();
+    testarValidador();
+    testarPipeline();
+    if (falhas > 0)
+    {
+        std::cerr << falhas << " verificacoes falharam" << std::endl;
+        return 1;
+    }
+    std::cout << "Todos os testes passaram" << std::endl;
+    return 0;
+}
\ No newline at end of file
@@ -1,99 +1,15 @@
+#include "consolidacao.h"
+
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
-#include <map>
 #include <ctime>
 #include <iomanip>
+#include <chrono>
+#include <cstdlib>
 
-struct Transacao
-{
-    int dia, mes, ano;
-    int agencia_origem, conta_origem;
-    double valor;
-    int agencia_destino, conta_destino;
-};
-
-struct MovimentacaoConsolidada
-{
-    int agencia, conta;
-    double subtotal_especie = 0.0;
-    double subtotal_eletronica = 0.0;
-    int total_transacoes = 0;
-};
-
-void carregarTransacoes(const std::string &arquivoCSV, std::vector<Transacao> &transacoes)
-{
-    std::ifstream file(arquivoCSV);
-    std::string linha, campo;
-    while (std::getline(file, linha))
-    {
-        std::stringstream ss(linha);
-        Transacao t;
-        std::getline(ss, campo, ',');
-        t.dia = std::stoi(campo);
-        std::getline(ss, campo, ',');
-        t.mes = std::stoi(campo);
-        std::getline(ss, campo, ',');
-        t.ano = std::stoi(campo);
-        std::getline(ss, campo, ',');
-        t.agencia_origem = std::stoi(campo);
-        std::getline(ss, campo, ',');
-        t.conta_origem = std::stoi(campo);
-        std::getline(ss, campo, ',');
-        t.valor = std::stod(campo);
-        std::getline(ss, campo, ',');
-        t.agencia_destino = campo.empty() ? 0 : std::stoi(campo);
-        std::getline(ss, campo, ',');
-        t.conta_destino = campo.empty() ? 0 : std::stoi(campo);
-        transacoes.push_back(t);
-    }
-}
-
-void consolidarMovimentacao(const std::vector<Transacao> &transacoes, int mes, int ano, std::map<int, MovimentacaoConsolidada> &consolidacao)
-{
-    for (const auto &t : transacoes)
-    {
-        if (t.mes == mes && t.ano == ano)
-        {
-            int chave = t.agencia_origem * 1000000 + t.conta_origem; // Cria uma chave única combinando agência e conta
-            consolidacao[chave].agencia = t.agencia_origem;
-            consolidacao[chave].conta = t.conta_origem;
-            if (t.agencia_destino == 0 && t.conta_destino == 0)
-            {
-                consolidacao[chave].subtotal_especie += t.valor;
-            }
-            else
-            {
-                consolidacao[chave].subtotal_eletronica += t.valor;
-            }
-            consolidacao[chave].total_transacoes++;
-        }
-    }
-}
-
-void salvarConsolidacaoBinaria(const std::map<int, MovimentacaoConsolidada> &consolidacao, int mes, int ano)
-{
-    std::ofstream binFile("consolidadas" + std::to_string(mes) + std::to_string(ano) + ".bin", std::ios::binary);
-    for (const auto &entry : consolidacao)
-    {
-        binFile.write(reinterpret_cast<const char *>(&entry.second), sizeof(MovimentacaoConsolidada));
-    }
-}
-
-bool carregarConsolidacaoBinaria(std::map<int, MovimentacaoConsolidada> &consolidacao, int mes, int ano)
-{
-    std::ifstream binFile("consolidadas" + std::to_string(mes) + std::to_string(ano) + ".bin", std::ios::binary);
-    if (!binFile)
-        return false;
-    MovimentacaoConsolidada mov;
-    while (binFile.read(reinterpret_cast<char *>(&mov), sizeof(MovimentacaoConsolidada)))
-    {
-        int chave = mov.agencia * 1000000 + mov.conta;
-        consolidacao[chave] = mov;
-    }
-    return true;
-}
+using namespace consolidacao;
 
 void atualizarLog(const std::string &mensagem)
 {
@@ -102,16 +18,16 @@ void atualizarLog(const std::string &mensagem)
     logFile << std::put_time(std::localtime(&t), "%c") << ": " << mensagem << std::endl;
 }
 
-void consultarMovimentacao(int mes, int ano)
+void consultarMovimentacao(int mes, int ano, bool usarPipeline)
 {
-    std::string nome_arquivo_bin = "consolidadas" + std::to_string(mes) + std::to_string(ano) + ".bin";
-    std::map<int, MovimentacaoConsolidada> consolidados; // Usando `int` como chave
+    std::string nome_arquivo_bin = nomeArquivoConsolidacao(mes, ano);
+    ResultadoConsolidacao consolidados;
 
     // Verifica se o arquivo binário já existe
     if (std::ifstream(nome_arquivo_bin).is_open())
     {
         // Carrega consolidados do arquivo binário
-        if (carregarConsolidacaoBinaria(consolidados, mes, ano))
+        if (carregarConsolidacaoBinaria(consolidados, nome_arquivo_bin))
         {
             atualizarLog("Movimentacao carregada do arquivo binario para " + std::to_string(mes) + "/" + std::to_string(ano));
         }
@@ -122,20 +38,49 @@ void consultarMovimentacao(int mes, int ano)
     }
     else
     {
-        // Carrega as transações do arquivo CSV
-        std::vector<Transacao> transacoes;
-        carregarTransacoes("transacoes.csv", transacoes);
+        auto inicio = std::chrono::steady_clock::now();
+        bool usouIoUring = false;
+        Quarentena quarentena;
+        quarentena.caminho = "quarentena.csv";
+        MapaConsolidacao acumulado;
+        if (usarPipeline)
+        {
+            // Leitura, parse e consolidação sobrepostos
+            if (!consolidarMovimentacaoPipeline("transacoes.csv", mes, ano, acumulado, quarentena, usouIoUring))
+            {
+                std::cerr << "Erro ao ler transacoes.csv." << std::endl;
+                return;
+            }
+        }
+        else
+        {
+            // Carrega as transações do arquivo CSV
+            std::pmr::vector<Transacao> transacoes;
+            if (!carregarTransacoes("transacoes.csv", transacoes, quarentena))
+            {
+                std::cerr << "Erro ao ler transacoes.csv." << std::endl;
+                return;
+            }
 
-        // Realiza a consolidação das movimentações
-        consolidarMovimentacao(transacoes, mes, ano, consolidados);
+            // Realiza a consolidação das movimentações
+            consolidarMovimentacao(transacoes.data(), transacoes.size(), mes, ano, acumulado);
+        }
+        finalizarConsolidacao(acumulado, consolidados);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - inicio).count();
 
         // Salva a consolidação no arquivo binário
-        salvarConsolidacaoBinaria(consolidados, mes, ano);
-        atualizarLog("Movimentacao consolidada calculada para " + std::to_string(mes) + "/" + std::to_string(ano));
+        salvarConsolidacaoBinaria(consolidados.visao(), nome_arquivo_bin);
+        atualizarLog("Movimentacao consolidada calculada para " + std::to_string(mes) + "/" + std::to_string(ano) +
+                     " em " + std::to_string(ms) + " ms" + (usarPipeline ? (usouIoUring ? " (pipeline, io_uring)" : " (pipeline, threads)") : ""));
+        atualizarLog("Leitura de transacoes.csv: " + resumirQuarentena(quarentena));
+        if (quarentena.rejeitadas > 0)
+        {
+            std::cerr << "Aviso: " << resumirQuarentena(quarentena) << std::endl;
+        }
     }
 
     // Exibe as movimentações consolidadas
-    for (const auto &[chave, consolidado] : consolidados)
+    for (const auto &consolidado : consolidados.visao())
     {
         std::cout << "Agencia: " << consolidado.agencia << ", Conta: " << consolidado.conta << std::endl;
         std::cout << "Subtotal Dinheiro Vivo: " << consolidado.subtotal_especie << std::endl;
@@ -144,47 +89,78 @@ void consultarMovimentacao(int mes, int ano)
     }
 }
 
-void filtrarMovimentacao(int mes, int ano, double x, double y, const std::string &tipoFiltro)
+void filtrarMovimentacao(int mes, int ano, const FiltroCompilado &filtro, const std::string &descricao)
 {
-    std::map<int, MovimentacaoConsolidada> consolidacao;
-    if (!carregarConsolidacaoBinaria(consolidacao, mes, ano))
+    // A consulta inteira vive numa arena descartada ao sair da função
+    std::pmr::monotonic_buffer_resource arena;
+    ResultadoConsolidacao consolidacao(&arena);
+    if (!carregarConsolidacaoBinaria(consolidacao, nomeArquivoConsolidacao(mes, ano)))
     {
         atualizarLog("Consolidacao nao encontrada para " + std::to_string(mes) + "/" + std::to_string(ano));
         return;
     }
     int count = 0;
-    for (const auto &entry : consolidacao)
+    for (const auto &mov : filtrar(consolidacao.visao(), filtro))
     {
-        bool condicao = (tipoFiltro == "E") ? (entry.second.subtotal_especie >= x && entry.second.subtotal_eletronica >= y) : (entry.second.subtotal_especie >= x || entry.second.subtotal_eletronica >= y);
-        if (condicao)
-        {
-            std::cout << "Agencia: " << entry.second.agencia << ", Conta: " << entry.second.conta
-                      << ", Especie: " << entry.second.subtotal_especie
-                      << ", Eletronica: " << entry.second.subtotal_eletronica
-                      << ", Total Transacoes: " << entry.second.total_transacoes << std::endl;
-            count++;
-        }
+        std::cout << "Agencia: " << mov.agencia << ", Conta: " << mov.conta
+                  << ", Especie: " << mov.subtotal_especie
+                  << ", Eletronica: " << mov.subtotal_eletronica
+                  << ", Total Transacoes: " << mov.total_transacoes << std::endl;
+        count++;
     }
     atualizarLog("Filtragem realizada para " + std::to_string(mes) + "/" + std::to_string(ano) +
-                 " com X=" + std::to_string(x) + ", Y=" + std::to_string(y) + ", Tipo: " + tipoFiltro +
-                 ". Registros encontrados: " + std::to_string(count));
+                 " com " + descricao + ". Registros encontrados: " + std::to_string(count));
 }
 
-int main()
+void filtrarMovimentacao(int mes, int ano, double x, double y, const std::string &tipoFiltro)
+{
+    filtrarMovimentacao(mes, ano, criarFiltroLimiar(x, y, tipoFiltro == "E"),
+                        "X=" + std::to_string(x) + ", Y=" + std::to_string(y) + ", Tipo: " + tipoFiltro);
+}
+
+bool lerNumero(const std::string &texto, double &valor)
+{
+    char *fim = nullptr;
+    valor = std::strtod(texto.c_str(), &fim);
+    return !texto.empty() && *fim == '\0';
+}
+
+int main(int argc, char *argv[])
 {
-    std::vector<Transacao> transacoes;
-    carregarTransacoes("transacoes.csv", transacoes);
+    // "--pipeline" troca a leitura síncrona do CSV pela ingestão em pipeline
+    bool usarPipeline = argc > 1 && std::string(argv[1]) == "--pipeline";
 
     int mes, ano;
     std::cout << "Digite o mes e o ano para a consulta: ";
     std::cin >> mes >> ano;
-    consultarMovimentacao(mes, ano);
+    consultarMovimentacao(mes, ano, usarPipeline);
 
+    // Aceita o formato antigo "X Y E/OU", lido token a token como antes (os
+    // valores podem vir em linhas separadas), ou uma expressao de filtro em uma linha.
+    // Dois numeros iniciais identificam o formato antigo.
+    std::cout << "Digite os valores de X e Y e o tipo de filtro (E/OU), ou uma expressao de filtro: ";
     double x, y;
-    std::string tipoFiltro;
-    std::cout << "Digite os valores de X e Y para a filtragem e o tipo de filtro (E/OU): ";
-    std::cin >> x >> y >> tipoFiltro;
-    filtrarMovimentacao(mes, ano, x, y, tipoFiltro);
+    std::string primeiro, segundo, resto;
+    std::cin >> primeiro;
+    if (lerNumero(primeiro, x) && std::cin >> segundo && lerNumero(segundo, y))
+    {
+        std::string tipoFiltro;
+        std::cin >> tipoFiltro;
+        filtrarMovimentacao(mes, ano, x, y, tipoFiltro);
+    }
+    else
+    {
+        std::getline(std::cin, resto);
+        std::string entrada = primeiro + (segundo.empty() ? "" : " " + segundo) + resto;
+        FiltroCompilado filtro;
+        std::string erro;
+        if (!compilarFiltro(entrada, filtro, erro))
+        {
+            std::cerr << "Filtro invalido: " << erro << std::endl;
+            return 1;
+        }
+        filtrarMovimentacao(mes, ano, filtro, "filtro: " + entrada);
+    }
 
     return 0;
 }
\ No newline at end of file